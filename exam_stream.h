@@ -0,0 +1,106 @@
+// Streaming exam corpus for part2a/part2b (-e ARCHIVE)
+// Instead of one file per exam, exams are read from a single stream with
+// one student number per line. ".gz" and ".zst" archives are decoded by a
+// gzip/zstd child process and "-" reads stdin, so an appended log can be
+// piped in. A loader process decodes records into a small ring buffer in
+// shared memory while the TAs work, keeping memory use bounded.
+// Dennis Chen student#101236818
+// Mithushan Ravichandramohan student#101262467
+
+#ifndef EXAM_STREAM_H
+#define EXAM_STREAM_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#define EXAM_RING_SIZE 64
+#define EXAM_END       (-2)   // pushed once at end of stream, never consumed
+
+typedef struct {
+    long head;                  // slots pushed by the loader, EXAM_END included
+    long tail;                  // records taken by TAs
+    long records;               // exams read from the stream so far
+    int  slot[EXAM_RING_SIZE];  // student numbers, slot[i % EXAM_RING_SIZE]
+} exam_ring_t;
+
+static int has_suffix(const char *s, const char *suffix) {
+    size_t n = strlen(s), m = strlen(suffix);
+    return n >= m && strcmp(s + n - m, suffix) == 0;
+}
+
+// Opens the corpus for sequential reading. For compressed archives the
+// decoder runs as a child writing to a pipe; its pid is stored in *decoder.
+static FILE *exam_stream_open(const char *path, pid_t *decoder) {
+    *decoder = -1;
+    if (strcmp(path, "-") == 0) return stdin;
+
+    const char *tool = has_suffix(path, ".gz")  ? "gzip" :
+                       has_suffix(path, ".zst") ? "zstd" : NULL;
+    if (!tool) return fopen(path, "r");
+
+    int fd[2];
+    if (pipe(fd) < 0) return NULL;
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(fd[0]);
+        close(fd[1]);
+        return NULL;
+    }
+    if (pid == 0) {
+        dup2(fd[1], STDOUT_FILENO);
+        close(fd[0]);
+        close(fd[1]);
+        execlp(tool, tool, "-dc", "--", path, (char *)NULL);
+        perror("exec decoder");
+        _exit(127);
+    }
+    close(fd[1]);
+    *decoder = pid;
+    return fdopen(fd[0], "r");
+}
+
+// Next student number from the stream. Blank and non-numeric lines are
+// skipped. Returns 0 at end of stream.
+static int exam_stream_next(FILE *f, int *student) {
+    char buf[64];
+    while (fgets(buf, sizeof(buf), f)) {
+        char *end;
+        long v = strtol(buf, &end, 10);
+        if (end != buf && v >= 0) {
+            *student = (int)v;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Returns 0 if the whole stream was read. A read error or a decoder that
+// failed (e.g. a truncated .gz) means exams are missing from the end.
+static int exam_stream_close(FILE *f, pid_t decoder) {
+    int failed = ferror(f);
+    if (failed) fprintf(stderr, "Exam stream: read error\n");
+    if (f != stdin) fclose(f);
+    if (decoder > 0) {
+        int status;
+        if (waitpid(decoder, &status, 0) < 0) {
+            perror("waitpid decoder");
+            return -1;
+        }
+        if (WIFEXITED(status) && WEXITSTATUS(status) != 0) {
+            fprintf(stderr, "Exam stream: decoder exited with status %d\n",
+                    WEXITSTATUS(status));
+            failed = 1;
+        } else if (WIFSIGNALED(status)) {
+            fprintf(stderr, "Exam stream: decoder killed by signal %d\n",
+                    WTERMSIG(status));
+            failed = 1;
+        }
+    }
+    return failed ? -1 : 0;
+}
+
+#endif
@@ -8,6 +8,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <stdint.h>
+#include <fcntl.h>
 #include <sys/ipc.h>
 #include <sys/shm.h>
 #include <sys/types.h>
@@ -15,6 +17,14 @@
 #include <string.h>
 #include <time.h>
 #include <errno.h>
+#include <signal.h>
+
+#include "ta_stats.h"
+#include "ta_check.h"
+#include "exam_stream.h"
+#include "ta_rubric.h"
+#include "ta_rng.h"
+#include "ta_trace.h"
 
 #define NUM_Q 5
 
@@ -25,11 +35,16 @@ typedef enum {
 } qstate_t;
 
 typedef struct {
+    stats_t stats;                // live counters for ta_stat; must stay first
     char rubric_text[NUM_Q][32];  // store each rubric line as a small string
     int  current_exam_index;      // index into exam_files[]
     int  student_number;          // current exam's student number
     qstate_t question_state[NUM_Q];
     int  terminate;               // 0 = keep going, 1 = stop (9999 reached)
+    int  rubric_version;          // bumped when rubric.txt is edited outside the run
+    char rubric_on_disk[NUM_Q][32];  // rubric as we last loaded/saved it
+    trace_shared_t trace;         // -t: events so far (picks, DONE writes, loads)
+    exam_ring_t ring;             // -e: exams decoded by the loader, not yet taken
 } shared_t;
 
 /*CONFIG*/
@@ -44,22 +59,14 @@ static const char *exam_files[] = {
 };
 static const int num_exams = sizeof(exam_files) / sizeof(exam_files[0]);
 static const char *rubric_filename = "rubric.txt";
+static const char *exam_stream_path = NULL;  // -e: read exams from one stream instead
 
 /*UTILS*/
 
-static double urand01(void) {
-    // uniform [0,1)
-    return (double)rand() / ((double)RAND_MAX + 1.0);
-}
-
-static void sleep_random(double min_s, double max_s) {
-    double span = max_s - min_s;
-    double s = min_s + urand01() * span;
-    if (s < 0) s = 0;
+static double now_s(void) {
     struct timespec ts;
-    ts.tv_sec = (time_t)s;
-    ts.tv_nsec = (long)((s - ts.tv_sec) * 1e9);
-    nanosleep(&ts, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
 }
 
 static void die(const char *msg) {
@@ -85,6 +92,7 @@ static void load_rubric_into_shared(shared_t *sh) {
         snprintf(sh->rubric_text[i], sizeof(sh->rubric_text[i]), "%s", buf);
     }
     fclose(f);
+    memcpy(sh->rubric_on_disk, sh->rubric_text, sizeof(sh->rubric_on_disk));
 }
 
 static void save_rubric_from_shared(shared_t *sh) {
@@ -97,6 +105,7 @@ static void save_rubric_from_shared(shared_t *sh) {
         fprintf(f, "%s\n", sh->rubric_text[i]);
     }
     fclose(f);
+    memcpy(sh->rubric_on_disk, sh->rubric_text, sizeof(sh->rubric_on_disk));
 }
 
 /*EXAM I/O*/
@@ -118,6 +127,59 @@ static int load_exam_file(const char *filename) {
     return num;
 }
 
+/*EXAM STREAM*/
+
+// No semaphores in part2a: ring indices are published with atomic
+// loads/stores and both sides poll. Two TAs popping at once can still take
+// the same exam, which is the same race as loading the next exam file.
+static void ring_push(shared_t *sh, int student) {
+    struct timespec ts = { 0, 1000000 };  // 1 ms poll while the ring is full
+    long head = sh->ring.head;
+    while (head - __atomic_load_n(&sh->ring.tail, __ATOMIC_ACQUIRE) >= EXAM_RING_SIZE) {
+        nanosleep(&ts, NULL);
+    }
+    sh->ring.slot[head % EXAM_RING_SIZE] = student;
+    if (student != EXAM_END) {
+        sh->ring.records++;
+    }
+    __atomic_store_n(&sh->ring.head, head + 1, __ATOMIC_RELEASE);
+}
+
+// Blocks until the loader has decoded the next exam. EXAM_END is left in
+// the ring so every later caller sees it too.
+static int ring_pop(shared_t *sh) {
+    struct timespec ts = { 0, 1000000 };
+    long tail = __atomic_load_n(&sh->ring.tail, __ATOMIC_ACQUIRE);
+    while (__atomic_load_n(&sh->ring.head, __ATOMIC_ACQUIRE) == tail) {
+        nanosleep(&ts, NULL);
+    }
+    int student = sh->ring.slot[tail % EXAM_RING_SIZE];
+    if (student != EXAM_END) {
+        __atomic_store_n(&sh->ring.tail, tail + 1, __ATOMIC_RELEASE);
+    }
+    return student;
+}
+
+// Loader process: decodes the stream into the ring while the TAs work.
+// Exits non-zero if the stream could not be read to the end.
+static void exam_loader(shared_t *sh) {
+    pid_t decoder;
+    FILE *f = exam_stream_open(exam_stream_path, &decoder);
+    if (!f) {
+        perror("open exam stream");
+        ring_push(sh, EXAM_END);
+        _exit(EXIT_FAILURE);
+    }
+    int student;
+    while (exam_stream_next(f, &student)) {
+        ring_push(sh, student);
+    }
+    // Reap the decoder first so a failure is reported before the TAs stop
+    int failed = exam_stream_close(f, decoder) < 0;
+    ring_push(sh, EXAM_END);
+    _exit(failed ? EXIT_FAILURE : 0);
+}
+
 static void load_exam_into_shared(shared_t *sh, int exam_index) {
     if (exam_index < 0 || exam_index >= num_exams) {
         fprintf(stderr, "Invalid exam index %d\n", exam_index);
@@ -148,7 +210,9 @@ static const char *qstate_name(qstate_t s) {
 
 /*TA LOGIC*/
 
-static void maybe_correct_rubric_line(int id, shared_t *sh, int q_idx) {
+// Returns 1 if the line was corrected. The rubric file is only rewritten
+// here when save is set; batched passes save once at the end instead.
+static int maybe_correct_rubric_line(int id, shared_t *sh, int q_idx, int save) {
     printf("TA %d: BEFORE READ rubric_text[%d]\n", id, q_idx);
     fflush(stdout);
 
@@ -158,12 +222,12 @@ static void maybe_correct_rubric_line(int id, shared_t *sh, int q_idx) {
     printf("TA %d: AFTER READ rubric_text[%d] = \"%s\"\n", id, q_idx, local);
     fflush(stdout);
 
-    int correct = rand() % 2;  // 0 or 1
+    int correct = (int)(rng_next() >> 63);  // 0 or 1
 
     if (!correct) {
         printf("TA %d: Decided NOT to correct rubric line %d\n", id, q_idx + 1);
         fflush(stdout);
-        return;
+        return 0;
     }
 
     // Modify first character after comma (skipping spaces)
@@ -175,7 +239,10 @@ static void maybe_correct_rubric_line(int id, shared_t *sh, int q_idx) {
         char *p = comma + 1;
         while (*p == ' ') p++;
         if (*p != '\0') {
+            int before = (unsigned char)(*p);
             (*p) = (char)((unsigned char)(*p) + 1);
+            check_event(id, EV_RUBRIC_EDIT, -1, q_idx, before, (unsigned char)(*p));
+            sh->stats.ta[id].rubric_edits++;  // only edits that changed a character
         }
     }
 
@@ -183,10 +250,51 @@ static void maybe_correct_rubric_line(int id, shared_t *sh, int q_idx) {
            id, q_idx, sh->rubric_text[q_idx]);
     fflush(stdout);
 
-    // Save entire rubric back to file
-    printf("TA %d: Saving rubric to file \"%s\"\n", id, rubric_filename);
-    fflush(stdout);
-    save_rubric_from_shared(sh);
+    if (save) {
+        // Save entire rubric back to file
+        printf("TA %d: Saving rubric to file \"%s\"\n", id, rubric_filename);
+        fflush(stdout);
+        save_rubric_from_shared(sh);
+    }
+    return 1;
+}
+
+static int rubric_review_due(int id, shared_t *sh, int exams_started, int last_version) {
+    switch (rubric_policy) {
+        case RUBRIC_EVERY_N:   return exams_started % rubric_every_n == 0;
+        case RUBRIC_ON_CHANGE:
+            // Unsynchronized here like every other rubric access, so a read
+            // that overlaps a save can report a spurious change
+            if (rubric_file_changed(id, rubric_filename, NUM_Q, sh->rubric_text, sh->rubric_on_disk)) {
+                sh->rubric_version++;
+            }
+            return last_version != sh->rubric_version;
+        default:               return 1;
+    }
+}
+
+static void rubric_pass(int id, shared_t *sh) {
+    if (rubric_policy != RUBRIC_BATCH) {
+        // For each question, delay 0.5–1.0 s and call maybe_correct_rubric_line
+        for (int q = 0; q < NUM_Q; ++q) {
+            sleep_random(0.5, 1.0);
+            maybe_correct_rubric_line(id, sh, q, 1);
+        }
+        return;
+    }
+
+    // Batched: pay the review delay once and commit all edits in one save
+    sleep_random(0.5, 1.0);
+    int changed = 0;
+    for (int q = 0; q < NUM_Q; ++q) {
+        changed += maybe_correct_rubric_line(id, sh, q, 0);
+    }
+    if (changed) {
+        printf("TA %d: Saving %d rubric correction(s) to file \"%s\"\n",
+               id, changed, rubric_filename);
+        fflush(stdout);
+        save_rubric_from_shared(sh);
+    }
 }
 
 static int pick_question(int id, shared_t *sh) {
@@ -220,27 +328,37 @@ static void load_next_exam_if_any(int id, shared_t *sh) {
     fflush(stdout);
 
     int next = cur + 1;
-    if (next >= num_exams) {
-        printf("TA %d: No more exam files configured (index %d). "
+    sh->stats.ta[id].exams_completed++;
+
+    int student = EXAM_END;
+    if (exam_stream_path) {
+        printf("TA %d: Taking next exam from stream (index %d)\n", id, next);
+        fflush(stdout);
+        student = ring_pop(sh);
+    } else if (next < num_exams) {
+        printf("TA %d: Loading next exam file %s (index %d)\n",
+               id, exam_files[next], next);
+        fflush(stdout);
+        student = load_exam_file(exam_files[next]);
+    }
+
+    if (student == EXAM_END) {
+        printf("TA %d: No more exams (index %d). "
                "Setting terminate flag.\n", id, next);
         fflush(stdout);
         printf("TA %d: BEFORE WRITE terminate\n", id);
         fflush(stdout);
         sh->terminate = 1;
+        check_event(id, EV_TERMINATE, cur, -1, 0, 0);
         printf("TA %d: AFTER WRITE terminate = %d\n", id, sh->terminate);
         fflush(stdout);
         return;
     }
-
-    printf("TA %d: Loading next exam file %s (index %d)\n",
-           id, exam_files[next], next);
-    fflush(stdout);
-
-    int student = load_exam_file(exam_files[next]);
     if (student < 0) {
         printf("TA %d: Failed to load next exam. Setting terminate.\n", id);
         fflush(stdout);
         sh->terminate = 1;
+        check_event(id, EV_TERMINATE, cur, -1, 0, 0);
         return;
     }
 
@@ -248,10 +366,12 @@ static void load_next_exam_if_any(int id, shared_t *sh) {
     fflush(stdout);
 
     sh->current_exam_index = next;
+    sh->stats.current_exam_index = next;
     sh->student_number = student;
     for (int i = 0; i < NUM_Q; ++i) {
         sh->question_state[i] = Q_NOT_MARKED;
     }
+    check_event(id, EV_LOAD, next, -1, cur, student);
 
     printf("TA %d: AFTER WRITE current_exam_index = %d, student_number = %04d\n",
            id, sh->current_exam_index, sh->student_number);
@@ -267,13 +387,23 @@ static void load_next_exam_if_any(int id, shared_t *sh) {
         printf("TA %d: BEFORE WRITE terminate\n", id);
         fflush(stdout);
         sh->terminate = 1;
+        check_event(id, EV_TERMINATE, next, -1, 0, 0);
         printf("TA %d: AFTER WRITE terminate = %d\n", id, sh->terminate);
         fflush(stdout);
     }
 }
 
 static void ta_process(int id, shared_t *sh) {
-    srand((unsigned int)(time(NULL) ^ getpid()));
+    ta_stats_t *st = &sh->stats.ta[id];
+    st->active = 1;
+
+    rng_seed(base_seed + (unsigned long long)id);
+
+    int exams_started = 0;     // times we reached the rubric review point
+    int diverged = 0;          // replay events whose outcome differed from the trace
+    int last_version = -1;     // rubric_version after our last pass
+    int passes = 0, skipped = 0;
+    double rubric_time = 0.0;
 
     while (1) {
         // Check terminate flag
@@ -298,17 +428,24 @@ static void ta_process(int id, shared_t *sh) {
             break;
         }
 
-        printf("TA %d: Starting rubric pass for exam %04d\n", id, student);
-        fflush(stdout);
+        if (rubric_review_due(id, sh, exams_started++, last_version)) {
+            printf("TA %d: Starting rubric pass for exam %04d\n", id, student);
+            fflush(stdout);
 
-        // Rubric pass: for each question, delay 0.5–1.0 s and call maybe_correct_rubric_line
-        for (int q = 0; q < NUM_Q; ++q) {
-            sleep_random(0.5, 1.0);
-            maybe_correct_rubric_line(id, sh, q);
-        }
+            double t0 = now_s();
+            rubric_pass(id, sh);
+            last_version = sh->rubric_version;
+            rubric_time += now_s() - t0;
+            passes++;
 
-        printf("TA %d: Finished rubric pass for exam %04d\n", id, student);
-        fflush(stdout);
+            printf("TA %d: Finished rubric pass for exam %04d\n", id, student);
+            fflush(stdout);
+        } else {
+            printf("TA %d: Skipping rubric pass for exam %04d (policy %s)\n",
+                   id, student, rubric_policy_name(rubric_policy));
+            fflush(stdout);
+            skipped++;
+        }
 
         // Mark questions for this exam
         while (1) {
@@ -319,14 +456,21 @@ static void ta_process(int id, shared_t *sh) {
             fflush(stdout);
             if (t2) goto out;
 
+            if (!wait_for_turn(id, &sh->trace, &sh->terminate)) goto out;
             int q = pick_question(id, sh);
+            diverged += note_event(id, &sh->trace, 'C', sh->current_exam_index, q);
             if (q == -1) {
                 printf("TA %d: No unmarked questions left for current exam. "
                        "Will attempt to load next exam.\n", id);
                 fflush(stdout);
+                if (!wait_for_turn(id, &sh->trace, &sh->terminate)) goto out;
                 load_next_exam_if_any(id, sh);
+                diverged += note_event(id, &sh->trace, 'L', sh->current_exam_index, -1);
                 break;  // break marking loop -> go to outer loop (next exam)
             }
+            int exam = sh->current_exam_index;  // exam we think we claimed from
+            st->current_exam_index = exam;
+            check_event(id, EV_CLAIM, exam, q, 0, 0);
 
             printf("TA %d: Marking exam %04d question %d ...\n",
                    id, sh->student_number, q + 1);
@@ -334,9 +478,13 @@ static void ta_process(int id, shared_t *sh) {
 
             sleep_random(1.0, 2.0);
 
+            if (!wait_for_turn(id, &sh->trace, &sh->terminate)) goto out;
             printf("TA %d: BEFORE WRITE question_state[%d] = DONE\n", id, q);
             fflush(stdout);
             sh->question_state[q] = Q_DONE;
+            diverged += note_event(id, &sh->trace, 'D', sh->current_exam_index, q);
+            check_event(id, EV_DONE, exam, q, sh->current_exam_index, 0);
+            st->questions_marked++;
             printf("TA %d: AFTER WRITE question_state[%d] = %s\n",
                    id, q, qstate_name(sh->question_state[q]));
             fflush(stdout);
@@ -348,23 +496,98 @@ static void ta_process(int id, shared_t *sh) {
     }
 
 out:
+    printf("TA %d: Rubric policy %s: %d pass(es), %d skipped, %.3f s total, "
+           "%.3f s/exam\n", id, rubric_policy_name(rubric_policy),
+           passes, skipped, rubric_time,
+           exams_started ? rubric_time / exams_started : 0.0);
+    if (replay) {
+        diverged += replay_finish(id, &sh->trace);
+        printf("TA %d: Replay diverged from trace on %d event(s)\n", id, diverged);
+    }
     printf("TA %d: Terminating.\n", id);
     fflush(stdout);
+    st->active = 0;
     _exit(0);
 }
 
 /*MAIN*/
 
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-r always|every:N|changed|batch] [-s seed] "
+            "[-t record:FILE|replay:FILE] [-c LOGFILE] [-e ARCHIVE|-] "
+            "<num_TAs>=2\n", prog);
+}
+
 int main(int argc, char *argv[]) {
-    if (argc != 2) {
-        fprintf(stderr, "Usage: %s <num_TAs>=2\n", argv[0]);
+    const char *record_path = NULL, *replay_path = NULL, *check_path = NULL;
+    int seed_given = 0;
+    char *end;
+    int opt;
+    while ((opt = getopt(argc, argv, "r:s:t:c:e:")) != -1) {
+        switch (opt) {
+            case 'r':
+                if (parse_rubric_policy(optarg) < 0) {
+                    fprintf(stderr, "Invalid rubric policy \"%s\"\n", optarg);
+                    usage(argv[0]);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 's':
+                base_seed = strtoull(optarg, &end, 0);
+                if (end == optarg || *end) {
+                    fprintf(stderr, "Invalid seed \"%s\"\n", optarg);
+                    usage(argv[0]);
+                    return EXIT_FAILURE;
+                }
+                seed_given = 1;
+                break;
+            case 't':
+                if (strncmp(optarg, "record:", 7) == 0 && optarg[7]) {
+                    record_path = optarg + 7;
+                } else if (strncmp(optarg, "replay:", 7) == 0 && optarg[7]) {
+                    replay_path = optarg + 7;
+                } else {
+                    fprintf(stderr, "Invalid trace option \"%s\"\n", optarg);
+                    usage(argv[0]);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'c':
+                check_path = optarg;
+                break;
+            case 'e':
+                exam_stream_path = optarg;
+                break;
+            default:
+                usage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    if (argc - optind != 1) {
+        usage(argv[0]);
         return EXIT_FAILURE;
     }
-    int num_TAs = atoi(argv[1]);
+    int num_TAs = atoi(argv[optind]);
     if (num_TAs < 2) {
         fprintf(stderr, "num_TAs must be >= 2\n");
         return EXIT_FAILURE;
     }
+    if (num_TAs > STATS_MAX_TAS) {
+        fprintf(stderr, "num_TAs must be <= %d\n", STATS_MAX_TAS);
+        return EXIT_FAILURE;
+    }
+
+    // Without -s pick a seed, but print it so the run can be reproduced
+    if (!seed_given) {
+        base_seed = (unsigned long long)time(NULL) ^ ((unsigned long long)getpid() << 32);
+    }
+    if (record_path) {
+        trace_fd = open(record_path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+        if (trace_fd < 0) die("open trace");
+    }
+    if (replay_path) {
+        load_replay_trace(replay_path, num_TAs);
+    }
 
     // Create shared memory
     int shmid = shmget(IPC_PRIVATE, sizeof(shared_t), IPC_CREAT | 0666);
@@ -375,13 +598,60 @@ int main(int argc, char *argv[]) {
 
     memset(sh, 0, sizeof(*sh));
 
+    sh->stats.magic = STATS_MAGIC;
+    sh->stats.owner_pid = getpid();
+    sh->stats.num_tas = num_TAs;
+    sh->stats.num_exams = exam_stream_path ? 0 : num_exams;  // 0 = unknown
+    sh->stats.num_sems = 0;
+
+    // Checker log lives in its own segment so it costs nothing without -c
+    int check_shmid = -1;
+    if (check_path) {
+        check_shmid = shmget(IPC_PRIVATE, sizeof(check_log_t), IPC_CREAT | 0600);
+        if (check_shmid < 0) die("shmget check log");
+        check_log = (check_log_t *)shmat(check_shmid, NULL, 0);
+        if (check_log == (void *)-1) die("shmat check log");
+        memset(check_log, 0, sizeof(*check_log));
+    }
+
     // Initialize shared data: rubric + first exam
     load_rubric_into_shared(sh);
-    load_exam_into_shared(sh, 0);
+    pid_t loader_pid = -1;
+    if (exam_stream_path) {
+        loader_pid = fork();
+        if (loader_pid < 0) die("fork loader");
+        if (loader_pid == 0) exam_loader(sh);
+
+        int student = ring_pop(sh);
+        if (student == EXAM_END) {
+            fprintf(stderr, "Exam stream %s has no exams\n", exam_stream_path);
+            waitpid(loader_pid, NULL, 0);
+            shmdt(sh);
+            shmctl(shmid, IPC_RMID, NULL);
+            return EXIT_FAILURE;
+        }
+        sh->current_exam_index = 0;
+        sh->student_number = student;
+    } else {
+        load_exam_into_shared(sh, 0);
+    }
+    check_event(-1, EV_LOAD, 0, -1, -1, sh->student_number);
+
+    char rubric_before[NUM_Q][32];
+    memcpy(rubric_before, sh->rubric_text, sizeof(rubric_before));
 
     printf("Parent: Loaded rubric and first exam %s (student %04d) "
            "into shared memory.\n",
-           exam_files[0], sh->student_number);
+           exam_stream_path ? exam_stream_path : exam_files[0], sh->student_number);
+    printf("Parent: Shared memory id %d (watch live with ./ta_stat %d)\n",
+           shmid, shmid);
+    printf("Parent: RNG seed %llu (rerun with -s %llu)\n", base_seed, base_seed);
+    if (record_path) {
+        printf("Parent: Recording claim order to %s\n", record_path);
+    }
+    if (replay_path) {
+        printf("Parent: Replaying %d events from %s\n", replay_len, replay_path);
+    }
     fflush(stdout);
 
     // Fork TA processes
@@ -395,20 +665,54 @@ int main(int argc, char *argv[]) {
         }
     }
 
-    // Parent: wait for all children
-    for (int i = 0; i < num_TAs; ++i) {
+    // Parent: wait for all TAs. The loader may exit first (end of stream)
+    // or still be waiting for ring space once the sentinel stops the run.
+    int stream_failed = 0;
+    for (int reaped = 0; reaped < num_TAs; ) {
         int status;
-        wait(&status);
+        pid_t pid = wait(&status);
+        if (pid < 0) break;
+        if (pid == loader_pid) {
+            loader_pid = -1;
+            stream_failed = !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+        } else {
+            reaped++;
+        }
+    }
+    if (loader_pid > 0) {
+        kill(loader_pid, SIGTERM);
+        waitpid(loader_pid, NULL, 0);
     }
 
     printf("Parent: All TA processes finished. Cleaning up shared memory.\n");
+    if (stream_failed) {
+        printf("Parent: Exam stream %s ended early after %ld exams, run is incomplete\n",
+               exam_stream_path, sh->ring.records);
+    }
     fflush(stdout);
+    sh->stats.done = 1;
+
+    long violations = 0;
+    if (check_log) {
+        check_dump(check_path);
+        printf("Parent: Transition log written to %s\n", check_path);
+        int exams_total = exam_stream_path ? (int)sh->ring.records : num_exams;
+        violations = check_report(exams_total, NUM_Q,
+                                  (const char (*)[32])rubric_before,
+                                  (const char (*)[32])sh->rubric_text);
+        if (shmdt(check_log) < 0) perror("shmdt check log");
+        if (shmctl(check_shmid, IPC_RMID, NULL) < 0) perror("shmctl check log");
+    }
 
     // Detach and remove shared memory
     if (shmdt(sh) < 0) perror("shmdt");
     if (shmctl(shmid, IPC_RMID, NULL) < 0) perror("shmctl IPC_RMID");
 
-    return EXIT_SUCCESS;
+    if (trace_fd >= 0) close(trace_fd);
+    free(replay);
+
+    // In check mode the exit status says whether the run was correct
+    return violations || stream_failed ? EXIT_FAILURE : EXIT_SUCCESS;
 }
 
 
@@ -1,5 +1,6 @@
 // Part 2b: Semaphore based synchronization with shared memory
-// Forked processes (TAs), SysV shared memory, SysV semaphores
+// Forked processes (TAs), SysV shared memory + SysV semaphores, or
+// POSIX shared memory + process-shared sem_t (-b posix)
 // All shared memory reads/writes are logged. Based on Part 2a logic
 
 // Dennis Chen student#101236818
@@ -10,6 +11,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <stdint.h>
+#include <fcntl.h>
 #include <sys/ipc.h>
 #include <sys/shm.h>
 #include <sys/types.h>
@@ -17,7 +20,17 @@
 #include <string.h>
 #include <time.h>
 #include <errno.h>
+#include <signal.h>
 #include <sys/sem.h>
+#include <sys/mman.h>
+#include <semaphore.h>
+
+#include "ta_stats.h"
+#include "ta_check.h"
+#include "exam_stream.h"
+#include "ta_rubric.h"
+#include "ta_rng.h"
+#include "ta_trace.h"
 
 #define NUM_Q 5
 
@@ -27,12 +40,27 @@ typedef enum {
     Q_DONE = 2
 } qstate_t;
 
+enum {
+    SEM_RUBRIC = 0,
+    SEM_EXAMLOAD = 1,
+    SEM_QUESTIONS = 2,
+    SEM_RING_ITEMS = 3,   /* -e: decoded exams waiting in the ring */
+    SEM_RING_SLOTS = 4,   /* -e: free ring slots */
+    SEM_COUNT = 5
+};
+
 typedef struct {
+    stats_t stats;  /* must stay first, ta_stat reads it */
     char rubric_text[NUM_Q][32];
     int  current_exam_index;
     int  student_number;
     qstate_t question_state[NUM_Q];
     int  terminate;
+    int  rubric_version;           /* rubric.txt edits from outside the run */
+    char rubric_on_disk[NUM_Q][32];
+    trace_shared_t trace;  /* -t */
+    exam_ring_t ring;       /* -e only */
+    sem_t psem[SEM_COUNT];  /* POSIX backend only */
 } shared_t;
 
 /*CONFIG*/
@@ -51,20 +79,14 @@ static const char *exam_files[] = {
 };
 static const int num_exams = sizeof(exam_files)/sizeof(exam_files[0]);
 static const char *rubric_filename = "rubric.txt";
+static const char *exam_stream_path = NULL;  /* -e */
 
 /*UTILS*/
 
-static double urand01(void) {
-    return (double)rand() / ((double)RAND_MAX + 1.0);
-}
-
-static void sleep_random(double min_s, double max_s) {
-    double span = max_s - min_s;
-    double s = min_s + urand01() * span;
+static double now_s(void) {
     struct timespec ts;
-    ts.tv_sec = (time_t)s;
-    ts.tv_nsec = (long)((s - ts.tv_sec) * 1e9);
-    nanosleep(&ts, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
 }
 
 static void die(const char *msg) {
@@ -84,6 +106,7 @@ static void load_rubric_into_shared(shared_t *sh) {
         snprintf(sh->rubric_text[i], sizeof(sh->rubric_text[i]), "%s", buf);
     }
     fclose(f);
+    memcpy(sh->rubric_on_disk, sh->rubric_text, sizeof(sh->rubric_on_disk));
 }
 
 static void save_rubric_from_shared(shared_t *sh) {
@@ -93,6 +116,7 @@ static void save_rubric_from_shared(shared_t *sh) {
         fprintf(f, "%s\n", sh->rubric_text[i]);
     }
     fclose(f);
+    memcpy(sh->rubric_on_disk, sh->rubric_text, sizeof(sh->rubric_on_disk));
 }
 
 static int load_exam_file(const char *filename) {
@@ -112,25 +136,265 @@ static void load_exam_into_shared(shared_t *sh, int index) {
         sh->question_state[i] = Q_NOT_MARKED;
 }
 
+/*IPC BACKEND*/
+
+/*
+ * sysv:  shmget/shmat + semop, every P()/V() is a system call.
+ * posix: shm_open/mmap + sem_t inside shared_t, uncontended
+ *        P()/V() stay in user space (futex only when blocking).
+ */
+typedef enum {
+    BACKEND_SYSV = 0,
+    BACKEND_POSIX
+} ipc_backend_t;
+
+static ipc_backend_t backend = BACKEND_SYSV;
+static int shmid = -1;        /* sysv */
+static char shm_name[64];     /* posix, "" when there is no object */
+static int semid = -1;        /* sysv */
+static sem_t *psem;           /* posix, points into shared_t */
+static pid_t ipc_owner;       /* process that created the objects above */
+
+/* atexit: a die() after creating the objects (e.g. no rubric.txt) must
+ * not leave /dev/shm/sysc4001_ta_<pid> or SysV ids behind. Children that
+ * die() run this too, so only the owner removes anything. */
+static void ipc_cleanup(void) {
+    if (getpid() != ipc_owner)
+        return;
+    if (shm_name[0])
+        shm_unlink(shm_name);
+    if (shmid >= 0)
+        shmctl(shmid, IPC_RMID, NULL);
+    if (semid >= 0)
+        semctl(semid, 0, IPC_RMID);
+}
+
+static shared_t *shared_create(void) {
+    shared_t *sh;
+    if (!ipc_owner) {
+        ipc_owner = getpid();
+        atexit(ipc_cleanup);
+    }
+    if (backend == BACKEND_POSIX) {
+        char name[sizeof(shm_name)];
+        snprintf(name, sizeof(name), "/sysc4001_ta_%d", (int)getpid());
+        int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0666);
+        if (fd < 0) die("shm_open");
+        strcpy(shm_name, name);  /* ours now, removed on any exit */
+        if (ftruncate(fd, sizeof(shared_t)) < 0) die("ftruncate");
+        sh = mmap(NULL, sizeof(shared_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (sh == MAP_FAILED) die("mmap");
+        close(fd);
+    } else {
+        shmid = shmget(IPC_PRIVATE, sizeof(shared_t), IPC_CREAT | 0666);
+        if (shmid < 0) die("shmget");
+        sh = shmat(shmid, NULL, 0);
+        if (sh == (void *)-1) die("shmat");
+    }
+    memset(sh, 0, sizeof(*sh));
+    return sh;
+}
+
+static void shared_destroy(shared_t *sh) {
+    if (backend == BACKEND_POSIX) {
+        munmap(sh, sizeof(*sh));
+        shm_unlink(shm_name);
+        shm_name[0] = '\0';
+    } else {
+        shmdt(sh);
+        shmctl(shmid, IPC_RMID, NULL);
+        shmid = -1;
+    }
+}
+
+static int sem_initial(int sem) {
+    if (sem == SEM_RING_ITEMS) return 0;
+    if (sem == SEM_RING_SLOTS) return EXAM_RING_SIZE;
+    return 1;
+}
+
+static void sems_create(shared_t *sh) {
+    if (backend == BACKEND_POSIX) {
+        psem = sh->psem;
+        for (int i = 0; i < SEM_COUNT; ++i)
+            if (sem_init(&psem[i], 1, sem_initial(i)) < 0) die("sem_init");
+        return;
+    }
+    semid = semget(IPC_PRIVATE, SEM_COUNT, IPC_CREAT | 0666);
+    if (semid < 0) die("semget");
+
+    for (int i = 0; i < SEM_COUNT; ++i)
+        semctl(semid, i, SETVAL, sem_initial(i));
+}
+
+static void sems_destroy(void) {
+    if (backend == BACKEND_POSIX) {
+        for (int i = 0; i < SEM_COUNT; ++i)
+            sem_destroy(&psem[i]);
+    } else {
+        semctl(semid, 0, IPC_RMID);
+        semid = -1;
+    }
+}
+
 /*SEMAPHORES*/
 
-enum {
-    SEM_RUBRIC = 0,
-    SEM_EXAMLOAD = 1,
-    SEM_QUESTIONS = 2,
-    SEM_COUNT = 3
-};
+static ta_stats_t *my_stats;  /* this process's slot, NULL in the parent */
 
-static int semid;
+/* Plain blocking wait, no stats */
+static void P_raw(int sem) {
+    if (backend == BACKEND_POSIX) {
+        while (sem_wait(&psem[sem]) < 0 && errno == EINTR)
+            ;
+    } else {
+        struct sembuf op = { sem, -1, 0 };
+        semop(semid, &op, 1);
+    }
+}
+
+/* 1 if the semaphore was free and is now taken */
+static int try_P(int sem) {
+    if (backend == BACKEND_POSIX)
+        return sem_trywait(&psem[sem]) == 0;
+    struct sembuf op = { sem, -1, IPC_NOWAIT };
+    return semop(semid, &op, 1) == 0;
+}
 
+/* Uncontended P() is a single try_P(); the clock is only read when we
+ * actually have to block, so stats cost nothing on the fast path. The
+ * wait is published while it lasts so ta_stat can count long waits
+ * (the loader on a full ring) before they end. */
 static void P(int sem) {
-    struct sembuf op = { sem, -1, 0 };
-    semop(semid, &op, 1);
+    if (try_P(sem))
+        return;
+    double t0 = now_s();
+    if (my_stats) {
+        my_stats->wait_sem = sem;
+        my_stats->wait_start_ns = (long)(t0 * 1e9);
+    }
+    P_raw(sem);
+    if (my_stats) {
+        my_stats->blocked_ns[sem] += (long)((now_s() - t0) * 1e9);
+        my_stats->wait_start_ns = 0;
+    }
 }
 
 static void V(int sem) {
-    struct sembuf op = { sem, +1, 0 };
-    semop(semid, &op, 1);
+    if (backend == BACKEND_POSIX) {
+        sem_post(&psem[sem]);
+    } else {
+        struct sembuf op = { sem, +1, 0 };
+        semop(semid, &op, 1);
+    }
+}
+
+/*EXAM STREAM*/
+
+/* Loader side. Single producer, so head needs no lock. */
+static void ring_push(shared_t *sh, int student) {
+    P(SEM_RING_SLOTS);
+    sh->ring.slot[sh->ring.head % EXAM_RING_SIZE] = student;
+    sh->ring.head++;
+    if (student != EXAM_END)
+        sh->ring.records++;
+    V(SEM_RING_ITEMS);
+}
+
+/* TA side, called with SEM_EXAMLOAD held (or by the parent before fork).
+ * EXAM_END is left in place and re-posted so later callers see it too. */
+static int ring_pop(shared_t *sh) {
+    P(SEM_RING_ITEMS);
+    int student = sh->ring.slot[sh->ring.tail % EXAM_RING_SIZE];
+    if (student == EXAM_END) {
+        V(SEM_RING_ITEMS);
+        return EXAM_END;
+    }
+    sh->ring.tail++;
+    V(SEM_RING_SLOTS);
+    return student;
+}
+
+/* Exits non-zero if the stream could not be read to the end */
+static void exam_loader(shared_t *sh) {
+    my_stats = &sh->stats.loader;  /* time blocked on a full ring */
+    my_stats->active = 1;
+    pid_t decoder;
+    FILE *f = exam_stream_open(exam_stream_path, &decoder);
+    if (!f) {
+        perror("exam stream open");
+        ring_push(sh, EXAM_END);
+        _exit(1);
+    }
+    int student;
+    while (exam_stream_next(f, &student))
+        ring_push(sh, student);
+    /* Reap the decoder first so a failure is reported before the TAs stop */
+    int failed = exam_stream_close(f, decoder) < 0;
+    ring_push(sh, EXAM_END);
+    my_stats->active = 0;
+    _exit(failed ? 1 : 0);
+}
+
+/*BENCHMARK*/
+
+/*
+ * Wall time per raw P_raw()+V() pair on SEM_QUESTIONS (no stats), procs
+ * processes at once. With procs > 1 this is wall time over the pairs of
+ * all processes, i.e. inverse throughput, not the latency of one pair.
+ */
+static double bench_pv(int iters, int procs) {
+    int started = 0;
+    double t0 = now_s();
+    if (procs == 1) {
+        for (int i = 0; i < iters; ++i) {
+            P_raw(SEM_QUESTIONS);
+            V(SEM_QUESTIONS);
+        }
+    } else {
+        for (int p = 0; p < procs; ++p) {
+            pid_t pid = fork();
+            if (pid < 0) {
+                perror("fork");
+                break;
+            }
+            if (pid == 0) {
+                for (int i = 0; i < iters; ++i) {
+                    P_raw(SEM_QUESTIONS);
+                    V(SEM_QUESTIONS);
+                }
+                _exit(0);
+            }
+            started++;
+        }
+        /* Only wait for the children that exist; -1 if any fork failed */
+        for (int p = 0; p < started; ++p)
+            wait(NULL);
+        if (started < procs)
+            return -1;
+    }
+    return (now_s() - t0) * 1e9 / ((double)iters * procs);
+}
+
+static void run_benchmark(int iters, int procs) {
+    const char *names[] = { "sysv", "posix" };
+    printf("Raw semaphore wait+post on one semaphore, no stats, %d pairs per process\n", iters);
+    printf("uncontended: ns per pair, one process\n");
+    printf("contended:   wall ns / total pairs, %d processes (inverse throughput)\n", procs);
+    printf("%-8s %14s %14s\n", "backend", "uncontended", "contended");
+    for (int b = BACKEND_SYSV; b <= BACKEND_POSIX; ++b) {
+        backend = b;
+        shared_t *sh = shared_create();
+        sems_create(sh);
+        double solo = bench_pv(iters, 1);
+        double many = bench_pv(iters, procs);
+        if (many < 0)
+            printf("%-8s %14.1f %14s\n", names[b], solo, "fork failed");
+        else
+            printf("%-8s %14.1f %14.1f (%d procs)\n", names[b], solo, many, procs);
+        fflush(stdout);
+        sems_destroy();
+        shared_destroy(sh);
+    }
 }
 
 /*LOGGING*/
@@ -146,7 +410,8 @@ static const char *qstate_name(qstate_t s) {
 
 /*TA LOGIC*/
 
-static void maybe_correct_rubric_line(int id, shared_t *sh, int q) {
+/* Returns 1 if the line was corrected. Saves only if save is set. */
+static int maybe_correct_rubric_line(int id, shared_t *sh, int q, int save) {
 
     printf("TA %d: BEFORE READ rubric_text[%d]\n", id, q);
     fflush(stdout);
@@ -155,10 +420,10 @@ static void maybe_correct_rubric_line(int id, shared_t *sh, int q) {
     printf("TA %d: AFTER READ rubric_text[%d] = \"%s\"\n", id, q, local);
     fflush(stdout);
 
-    if (!(rand() % 2)) {
+    if (!(rng_next() >> 63)) {
         printf("TA %d: No correction for rubric line %d\n", id, q+1);
         fflush(stdout);
-        return;
+        return 0;
     }
 
     printf("TA %d: BEFORE WRITE rubric_text[%d]\n", id, q);
@@ -167,15 +432,57 @@ static void maybe_correct_rubric_line(int id, shared_t *sh, int q) {
     if (comma) {
         char *p = comma + 1;
         while (*p == ' ') p++;
-        if (*p) *p = *p + 1;
+        if (*p) {
+            int before = (unsigned char)*p;
+            *p = *p + 1;
+            check_event(id, EV_RUBRIC_EDIT, -1, q, before, (unsigned char)*p);
+            sh->stats.ta[id].rubric_edits++;
+        }
     }
     printf("TA %d: AFTER WRITE rubric_text[%d] = \"%s\"\n",
            id, q, sh->rubric_text[q]);
     fflush(stdout);
 
-    printf("TA %d: Saving rubric...\n", id);
-    fflush(stdout);
-    save_rubric_from_shared(sh);
+    if (save) {
+        printf("TA %d: Saving rubric...\n", id);
+        fflush(stdout);
+        save_rubric_from_shared(sh);
+    }
+    return 1;
+}
+
+/* Called with SEM_RUBRIC held */
+static int rubric_review_due(int id, shared_t *sh, int exams_started, int last_version) {
+    switch (rubric_policy) {
+        case RUBRIC_EVERY_N: return exams_started % rubric_every_n == 0;
+        case RUBRIC_ON_CHANGE:  /* SEM_RUBRIC is held */
+            if (rubric_file_changed(id, rubric_filename, NUM_Q, sh->rubric_text, sh->rubric_on_disk))
+                sh->rubric_version++;
+            return last_version != sh->rubric_version;
+        default: return 1;
+    }
+}
+
+/* Called with SEM_RUBRIC held */
+static void rubric_pass(int id, shared_t *sh) {
+    if (rubric_policy != RUBRIC_BATCH) {
+        for (int q = 0; q < NUM_Q; ++q) {
+            sleep_random(0.5, 1.0);
+            maybe_correct_rubric_line(id, sh, q, 1);
+        }
+        return;
+    }
+
+    /* Batched: one delay for the whole rubric, one combined save */
+    sleep_random(0.5, 1.0);
+    int changed = 0;
+    for (int q = 0; q < NUM_Q; ++q)
+        changed += maybe_correct_rubric_line(id, sh, q, 0);
+    if (changed) {
+        printf("TA %d: Saving rubric (%d corrections)...\n", id, changed);
+        fflush(stdout);
+        save_rubric_from_shared(sh);
+    }
 }
 
 static int pick_question(int id, shared_t *sh) {
@@ -208,25 +515,36 @@ static void load_next_exam_if_any(int id, shared_t *sh) {
     fflush(stdout);
 
     int next = cur + 1;
-    if (next >= num_exams) {
+    sh->stats.ta[id].exams_completed++;
+
+    int num = EXAM_END;
+    if (exam_stream_path) {
+        printf("TA %d: Taking exam from stream (index %d)\n", id, next);
+        fflush(stdout);
+        num = ring_pop(sh);
+    } else if (next < num_exams) {
+        printf("TA %d: Loading exam %s (index %d)\n",
+               id, exam_files[next], next);
+        fflush(stdout);
+        num = load_exam_file(exam_files[next]);
+    }
+
+    if (num == EXAM_END) {
         printf("TA %d: No more exams. Setting terminate.\n", id);
         fflush(stdout);
         sh->terminate = 1;
+        check_event(id, EV_TERMINATE, cur, -1, 0, 0);
         return;
     }
 
-    printf("TA %d: Loading exam %s (index %d)\n",
-           id, exam_files[next], next);
-    fflush(stdout);
-
-    int num = load_exam_file(exam_files[next]);
-
     printf("TA %d: BEFORE WRITE exam fields\n", id);
     fflush(stdout);
     sh->current_exam_index = next;
+    sh->stats.current_exam_index = next;
     sh->student_number = num;
     for (int i = 0; i < NUM_Q; ++i)
         sh->question_state[i] = Q_NOT_MARKED;
+    check_event(id, EV_LOAD, next, -1, cur, num);
 
     printf("TA %d: AFTER WRITE: exam index=%d student=%04d\n",
            id, next, num);
@@ -236,11 +554,18 @@ static void load_next_exam_if_any(int id, shared_t *sh) {
         printf("TA %d: Sentinel exam reached. Setting terminate.\n", id);
         fflush(stdout);
         sh->terminate = 1;
+        check_event(id, EV_TERMINATE, next, -1, 0, 0);
     }
 }
 
 static void ta_process(int id, shared_t *sh) {
-    srand((unsigned)(time(NULL) ^ getpid()));
+    my_stats = &sh->stats.ta[id];
+    my_stats->active = 1;
+    rng_seed(base_seed + id);
+
+    int exams_started = 0, last_version = -1, diverged = 0;
+    int passes = 0, skipped = 0;
+    double rubric_time = 0.0;
 
     while (1) {
 
@@ -252,18 +577,27 @@ static void ta_process(int id, shared_t *sh) {
 
         /*RUBRIC PASS (protected with SEM_RUBRIC)*/
 
+        /* Timed from before P() so lock wait counts towards pass latency */
+        double t0 = now_s();
         P(SEM_RUBRIC);
-        printf("TA %d: Starting rubric pass.\n", id);
-        fflush(stdout);
+        if (rubric_review_due(id, sh, exams_started++, last_version)) {
+            printf("TA %d: Starting rubric pass.\n", id);
+            fflush(stdout);
 
-        for (int q = 0; q < NUM_Q; ++q) {
-            sleep_random(0.5, 1.0);
-            maybe_correct_rubric_line(id, sh, q);
-        }
+            rubric_pass(id, sh);
+            last_version = sh->rubric_version;
+            passes++;
 
-        printf("TA %d: Finished rubric pass.\n", id);
-        fflush(stdout);
+            printf("TA %d: Finished rubric pass.\n", id);
+            fflush(stdout);
+        } else {
+            printf("TA %d: Skipping rubric pass (policy %s).\n",
+                   id, rubric_policy_name(rubric_policy));
+            fflush(stdout);
+            skipped++;
+        }
         V(SEM_RUBRIC);
+        rubric_time += now_s() - t0;
 
         /*MARK QUESTIONS (protected with SEM_QUESTIONS)*/
 
@@ -274,17 +608,25 @@ static void ta_process(int id, shared_t *sh) {
             printf("TA %d: AFTER READ terminate = %d\n", id, sh->terminate);
             fflush(stdout);
 
+            if (!wait_for_turn(id, &sh->trace, &sh->terminate)) goto end;
             P(SEM_QUESTIONS);
             int q = pick_question(id, sh);
+            int exam = sh->current_exam_index;
+            diverged += note_event(id, &sh->trace, 'C', sh->current_exam_index, q);
+            if (q != -1)
+                check_event(id, EV_CLAIM, exam, q, 0, 0);
             V(SEM_QUESTIONS);
 
             if (q == -1) {
                 /* No more questions so load next exam */
+                if (!wait_for_turn(id, &sh->trace, &sh->terminate)) goto end;
                 P(SEM_EXAMLOAD);
                 load_next_exam_if_any(id, sh);
+                diverged += note_event(id, &sh->trace, 'L', sh->current_exam_index, -1);
                 V(SEM_EXAMLOAD);
                 break;
             }
+            my_stats->current_exam_index = exam;
 
             printf("TA %d: Marking exam %04d Q%d...\n",
                    id, sh->student_number, q+1);
@@ -292,10 +634,14 @@ static void ta_process(int id, shared_t *sh) {
 
             sleep_random(1.0, 2.0);
 
+            if (!wait_for_turn(id, &sh->trace, &sh->terminate)) goto end;
             P(SEM_QUESTIONS);
             printf("TA %d: BEFORE WRITE question_state[%d] = DONE\n", id, q);
             fflush(stdout);
             sh->question_state[q] = Q_DONE;
+            diverged += note_event(id, &sh->trace, 'D', sh->current_exam_index, q);
+            check_event(id, EV_DONE, exam, q, sh->current_exam_index, 0);
+            my_stats->questions_marked++;
             printf("TA %d: AFTER WRITE question_state[%d] = DONE\n", id, q);
             fflush(stdout);
             V(SEM_QUESTIONS);
@@ -307,45 +653,186 @@ static void ta_process(int id, shared_t *sh) {
     }
 
 end:
+    printf("TA %d: Rubric policy %s: %d passes, %d skipped, %.3fs total, "
+           "%.3fs/exam\n", id, rubric_policy_name(rubric_policy),
+           passes, skipped, rubric_time,
+           exams_started ? rubric_time / exams_started : 0.0);
+    if (replay) {
+        diverged += replay_finish(id, &sh->trace);
+        printf("TA %d: Replay diverged on %d events\n", id, diverged);
+    }
     printf("TA %d: Terminating.\n", id);
     fflush(stdout);
+    my_stats->active = 0;
     _exit(0);
 }
 
 /*MAIN*/
 
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-b sysv|posix] [-r always|every:N|changed|batch] "
+            "[-s seed] [-t record:FILE|replay:FILE] [-c LOGFILE] "
+            "[-e ARCHIVE|-] [-L iterations] <num_TAs>=2\n", prog);
+}
+
 int main(int argc, char *argv[]) {
-    if (argc != 2) {
-        fprintf(stderr, "Usage: %s <num_TAs>=2\n", argv[0]);
+    const char *record_path = NULL, *replay_path = NULL, *check_path = NULL;
+    int seed_given = 0, bench_iters = 0;
+    char *end;
+    int opt;
+    while ((opt = getopt(argc, argv, "b:r:s:t:c:e:L:")) != -1) {
+        switch (opt) {
+            case 'b':
+                if (!strcmp(optarg, "sysv"))
+                    backend = BACKEND_SYSV;
+                else if (!strcmp(optarg, "posix"))
+                    backend = BACKEND_POSIX;
+                else {
+                    fprintf(stderr, "Invalid IPC backend \"%s\"\n", optarg);
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'r':
+                if (parse_rubric_policy(optarg) < 0) {
+                    fprintf(stderr, "Invalid rubric policy \"%s\"\n", optarg);
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 's':
+                base_seed = strtoull(optarg, &end, 0);
+                if (end == optarg || *end) {
+                    fprintf(stderr, "Invalid seed \"%s\"\n", optarg);
+                    usage(argv[0]);
+                    return 1;
+                }
+                seed_given = 1;
+                break;
+            case 't':
+                if (!strncmp(optarg, "record:", 7) && optarg[7])
+                    record_path = optarg + 7;
+                else if (!strncmp(optarg, "replay:", 7) && optarg[7])
+                    replay_path = optarg + 7;
+                else {
+                    fprintf(stderr, "Invalid trace option \"%s\"\n", optarg);
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'c':
+                check_path = optarg;
+                break;
+            case 'e':
+                exam_stream_path = optarg;
+                break;
+            case 'L':
+                bench_iters = (int)strtol(optarg, &end, 10);
+                if (end == optarg || *end || bench_iters < 1) {
+                    fprintf(stderr, "Invalid benchmark iteration count \"%s\"\n", optarg);
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    if (argc - optind != 1) {
+        usage(argv[0]);
         return 1;
     }
-    int n = atoi(argv[1]);
+    int n = atoi(argv[optind]);
     if (n < 2) {
         fprintf(stderr, "num_TAs must be >= 2\n");
         return 1;
     }
+    if (n > STATS_MAX_TAS) {
+        fprintf(stderr, "num_TAs must be <= %d\n", STATS_MAX_TAS);
+        return 1;
+    }
 
-    /* Shared memory */
-    int shmid = shmget(IPC_PRIVATE, sizeof(shared_t), IPC_CREAT | 0666);
-    if (shmid < 0) die("shmget");
-
-    shared_t *sh = shmat(shmid, NULL, 0);
-    if (sh == (void *)-1) die("shmat");
-
-    memset(sh, 0, sizeof(*sh));
+    /* -L: compare backends head to head, contended by num_TAs procs */
+    if (bench_iters) {
+        run_benchmark(bench_iters, n);
+        return 0;
+    }
 
-    load_rubric_into_shared(sh);
-    load_exam_into_shared(sh, 0);
+    /* Seed is always printed so any run can be repeated with -s */
+    if (!seed_given)
+        base_seed = (unsigned long long)time(NULL) ^ ((unsigned long long)getpid() << 32);
+    if (record_path) {
+        trace_fd = open(record_path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+        if (trace_fd < 0) die("trace open");
+    }
+    if (replay_path)
+        load_replay_trace(replay_path, n);
 
-    /* Semaphores */
-    semid = semget(IPC_PRIVATE, SEM_COUNT, IPC_CREAT | 0666);
-    if (semid < 0) die("semget");
+    /* Shared memory */
+    shared_t *sh = shared_create();
+
+    sh->stats.magic = STATS_MAGIC;
+    sh->stats.owner_pid = getpid();
+    sh->stats.num_tas = n;
+    sh->stats.num_exams = exam_stream_path ? 0 : num_exams;
+    sh->stats.num_sems = SEM_COUNT;
+    strcpy(sh->stats.sem_names[SEM_RUBRIC], "rubric");
+    strcpy(sh->stats.sem_names[SEM_EXAMLOAD], "examload");
+    strcpy(sh->stats.sem_names[SEM_QUESTIONS], "questions");
+    strcpy(sh->stats.sem_names[SEM_RING_ITEMS], "ring_items");
+    strcpy(sh->stats.sem_names[SEM_RING_SLOTS], "ring_slots");
+
+    /* Checker log: separate segment, only with -c */
+    int check_shmid = -1;
+    if (check_path) {
+        check_shmid = shmget(IPC_PRIVATE, sizeof(check_log_t), IPC_CREAT | 0600);
+        if (check_shmid < 0) die("shmget check");
+        check_log = shmat(check_shmid, NULL, 0);
+        if (check_log == (void *)-1) die("shmat check");
+        memset(check_log, 0, sizeof(*check_log));
+    }
 
-    semctl(semid, SEM_RUBRIC,   SETVAL, 1);
-    semctl(semid, SEM_EXAMLOAD, SETVAL, 1);
-    semctl(semid, SEM_QUESTIONS,SETVAL, 1);
+    /* Semaphores (before the loader starts using the ring ones) */
+    sems_create(sh);
 
-    printf("Parent: Initialized shared memory + semaphores.\n");
+    load_rubric_into_shared(sh);
+    pid_t loader = -1;
+    if (exam_stream_path) {
+        loader = fork();
+        if (loader < 0) die("fork loader");
+        if (loader == 0)
+            exam_loader(sh);
+
+        int num = ring_pop(sh);
+        if (num == EXAM_END) {
+            fprintf(stderr, "No exams in %s\n", exam_stream_path);
+            waitpid(loader, NULL, 0);
+            sems_destroy();
+            shared_destroy(sh);
+            return 1;
+        }
+        sh->current_exam_index = 0;
+        sh->student_number = num;
+    } else {
+        load_exam_into_shared(sh, 0);
+    }
+    check_event(-1, EV_LOAD, 0, -1, -1, sh->student_number);
+
+    char rubric_before[NUM_Q][32];
+    memcpy(rubric_before, sh->rubric_text, sizeof(rubric_before));
+
+    printf("Parent: Initialized shared memory + semaphores (%s).\n",
+           backend == BACKEND_POSIX ? "posix" : "sysv");
+    if (backend == BACKEND_POSIX)
+        printf("Parent: shm %s (live stats: ./ta_stat %s)\n", shm_name, shm_name);
+    else
+        printf("Parent: shmid %d (live stats: ./ta_stat %d)\n", shmid, shmid);
+    printf("Parent: seed %llu (rerun with -s %llu)\n", base_seed, base_seed);
+    if (record_path)
+        printf("Parent: Recording claims to %s\n", record_path);
+    if (replay_path)
+        printf("Parent: Replaying %d events from %s\n", replay_len, replay_path);
     fflush(stdout);
 
     /* Fork TAs */
@@ -354,16 +841,48 @@ int main(int argc, char *argv[]) {
             ta_process(i, sh);
     }
 
-    for (int i = 0; i < n; ++i)
-        wait(NULL);
+    /* Reap the TAs; the loader may finish first or still be blocked on
+     * a full ring after the sentinel, in which case it is stopped here */
+    int stream_failed = 0, status;
+    for (int reaped = 0; reaped < n; ) {
+        pid_t pid = wait(&status);
+        if (pid < 0)
+            break;
+        if (pid == loader) {
+            loader = -1;
+            stream_failed = !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+        } else
+            reaped++;
+    }
+    if (loader > 0) {
+        kill(loader, SIGTERM);
+        waitpid(loader, NULL, 0);
+    }
 
     printf("Parent: All TAs terminated. Cleaning up.\n");
+    if (stream_failed)
+        printf("Parent: Exam stream %s ended early after %ld exams, run is incomplete\n",
+               exam_stream_path, sh->ring.records);
     fflush(stdout);
+    sh->stats.done = 1;
+
+    long violations = 0;
+    if (check_log) {
+        check_dump(check_path);
+        printf("Parent: Transition log written to %s\n", check_path);
+        int exams_total = exam_stream_path ? (int)sh->ring.records : num_exams;
+        violations = check_report(exams_total, NUM_Q,
+                                  (const char (*)[32])rubric_before,
+                                  (const char (*)[32])sh->rubric_text);
+        shmdt(check_log);
+        shmctl(check_shmid, IPC_RMID, NULL);
+    }
 
-    shmdt(sh);
-    shmctl(shmid, IPC_RMID, NULL);
-    semctl(semid, 0, IPC_RMID);
+    sems_destroy();
+    shared_destroy(sh);
+    if (trace_fd >= 0) close(trace_fd);
+    free(replay);
 
-    return 0;
+    return violations || stream_failed ? 1 : 0;
 }
 
@@ -0,0 +1,239 @@
+// Invariant checker for part2a/part2b (-c mode)
+// TAs append every shared state transition to a log in its own shared
+// memory segment. After the run the parent replays the log and counts
+// invariant violations.
+// Dennis Chen student#101236818
+// Mithushan Ravichandramohan student#101262467
+
+#ifndef TA_CHECK_H
+#define TA_CHECK_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CHECK_LOG_MAX 65536
+
+typedef enum {
+    EV_CLAIM = 0,     // question_state[q] NOT_MARKED -> IN_PROGRESS
+    EV_DONE,          // question_state[q] IN_PROGRESS -> DONE
+    EV_LOAD,          // current_exam_index a -> exam, student b
+    EV_RUBRIC_EDIT,   // rubric line q, char a -> b
+    EV_TERMINATE,     // terminate set (no more exams, or the 9999 sentinel)
+    EV_RUBRIC_RELOAD  // rubric line q reloaded from an edited file, char a -> b
+} check_kind_t;
+
+// exam is the exam the TA believes it is working on. For EV_DONE, a is
+// current_exam_index at the time of the write; if it differs from exam the
+// DONE landed on a newer exam's state.
+typedef struct {
+    long seq;
+    int  ta;
+    int  kind;
+    int  exam;
+    int  q;
+    int  a;
+    int  b;
+} check_event_t;
+
+typedef struct {
+    long len;        // next sequence number; may exceed CHECK_LOG_MAX
+    long dropped;
+    check_event_t ev[CHECK_LOG_MAX];
+} check_log_t;
+
+static check_log_t *check_log = NULL;  // NULL unless running with -c
+
+static const char *check_kind_name(int kind) {
+    switch (kind) {
+        case EV_CLAIM:         return "CLAIM";
+        case EV_DONE:          return "DONE";
+        case EV_LOAD:          return "LOAD";
+        case EV_RUBRIC_EDIT:   return "RUBRIC_EDIT";
+        case EV_TERMINATE:     return "TERMINATE";
+        case EV_RUBRIC_RELOAD: return "RUBRIC_RELOAD";
+        default:               return "UNKNOWN";
+    }
+}
+
+// The sequence number comes from an atomic counter so the log itself is
+// race-free even in part2a; only the simulated state is left unprotected.
+static void check_event(int ta, int kind, int exam, int q, int a, int b) {
+    if (!check_log) return;
+    long seq = __atomic_fetch_add(&check_log->len, 1, __ATOMIC_ACQ_REL);
+    if (seq >= CHECK_LOG_MAX) {
+        __atomic_fetch_add(&check_log->dropped, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    check_event_t *e = &check_log->ev[seq];
+    e->seq = seq;
+    e->ta = ta;
+    e->kind = kind;
+    e->exam = exam;
+    e->q = q;
+    e->a = a;
+    e->b = b;
+}
+
+static void check_dump(const char *path) {
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        perror("fopen check log");
+        return;
+    }
+    long n = check_log->len < CHECK_LOG_MAX ? check_log->len : CHECK_LOG_MAX;
+    for (long i = 0; i < n; ++i) {
+        const check_event_t *e = &check_log->ev[i];
+        fprintf(f, "%ld %d %s %d %d %d %d\n", e->seq, e->ta,
+                check_kind_name(e->kind), e->exam, e->q, e->a, e->b);
+    }
+    fclose(f);
+}
+
+// Character after "N, " on a rubric line, the one TAs correct.
+static int rubric_mark(const char *line) {
+    const char *p = strchr(line, ',');
+    if (!p) return -1;
+    p++;
+    while (*p == ' ') p++;
+    return (unsigned char)*p;
+}
+
+// Validates the log against the run's invariants, prints a report and
+// returns the total number of violations.
+static long check_report(int num_exams, int nq,
+                         const char (*rubric_before)[32],
+                         const char (*rubric_after)[32]) {
+    long n = check_log->len < CHECK_LOG_MAX ? check_log->len : CHECK_LOG_MAX;
+
+    int  *loaded   = calloc((size_t)num_exams, sizeof(int));
+    int  *replaced = calloc((size_t)num_exams, sizeof(int));  // before any claim
+    int  *claims   = calloc((size_t)num_exams * nq, sizeof(int));
+    int  *marks    = calloc((size_t)num_exams * nq, sizeof(int));
+    long *edits    = calloc((size_t)nq, sizeof(long));    // since the last reload
+    int  *base     = calloc((size_t)nq, sizeof(int));     // mark the edits apply to
+    if (!loaded || !replaced || !claims || !marks || !edits || !base) {
+        perror("calloc check");
+        exit(EXIT_FAILURE);
+    }
+
+    int sentinel = num_exams;  // exams at or after the 9999 sentinel are not marked
+    int last_loaded = 0;       // highest exam index loaded in the log
+    int shown = -1;            // exam most recently loaded
+    int shown_claimed = 0;     // whether anyone claimed from it since
+    long stale = 0, total_edits = 0, reloads = 0;
+    for (int q = 0; q < nq; ++q) {
+        base[q] = rubric_mark(rubric_before[q]);
+    }
+    for (long i = 0; i < n; ++i) {
+        const check_event_t *e = &check_log->ev[i];
+        if (e->kind == EV_LOAD && e->exam > last_loaded) last_loaded = e->exam;
+        int in_range = e->exam >= 0 && e->exam < num_exams;
+        switch (e->kind) {
+            case EV_LOAD:
+                if (in_range) loaded[e->exam]++;
+                // Loading over an exam nobody claimed from skips it, even
+                // though its index was loaded (e.g. two TAs both found
+                // exam x finished and the second loaded x + 2 over x + 1)
+                if (e->exam != shown) {
+                    if (shown >= 0 && shown < num_exams && !shown_claimed) replaced[shown] = 1;
+                    shown = e->exam;
+                    shown_claimed = 0;
+                }
+                if (e->b == 9999 && e->exam < sentinel) sentinel = e->exam;
+                break;
+            case EV_CLAIM:
+                if (in_range && e->q >= 0 && e->q < nq) claims[e->exam * nq + e->q]++;
+                if (e->exam == shown) shown_claimed = 1;
+                break;
+            case EV_DONE:
+                if (in_range && e->q >= 0 && e->q < nq) marks[e->exam * nq + e->q]++;
+                if (e->a != e->exam) stale++;
+                break;
+            case EV_RUBRIC_EDIT:
+                if (e->q >= 0 && e->q < nq) edits[e->q]++;
+                total_edits++;
+                break;
+            case EV_RUBRIC_RELOAD:
+                // The file replaced the line, so earlier edits can no longer
+                // be checked; later ones apply to the reloaded mark
+                if (e->q >= 0 && e->q < nq) {
+                    base[e->q] = e->b;
+                    edits[e->q] = 0;
+                }
+                if (e->q == 0) reloads++;
+                break;
+        }
+    }
+
+    // Once the log is full, later exams (possibly thousands with -e) have
+    // no events at all, and would all show up as skipped/unmarked. Exam x
+    // is fully logged if the load of x + 1 was (all claims on x come before
+    // it) and every TA that claimed on x has a later event, since a TA logs
+    // its DONE before anything else. Only those exams are checked.
+    int checked = sentinel;
+    if (check_log->dropped) {
+        if (last_loaded < checked) checked = last_loaded;
+        for (long i = 0; i < n; ++i) {
+            const check_event_t *e = &check_log->ev[i];
+            if (e->kind != EV_CLAIM || e->exam >= checked) continue;
+            long j = i + 1;
+            while (j < n && check_log->ev[j].ta != e->ta) j++;
+            if (j == n) checked = e->exam;
+        }
+    }
+
+    long skipped = 0, reloaded = 0, unmarked = 0, extra_marks = 0, extra_claims = 0;
+    for (int x = 0; x < checked; ++x) {
+        if (loaded[x] > 1) reloaded += loaded[x] - 1;
+        // A skipped exam counts once here, not as nq unmarked questions
+        if (loaded[x] == 0 || replaced[x]) {
+            skipped++;
+            continue;
+        }
+        for (int q = 0; q < nq; ++q) {
+            int c = claims[x * nq + q], m = marks[x * nq + q];
+            if (m == 0) unmarked++;
+            if (m > 1) extra_marks += m - 1;
+            if (c > 1) extra_claims += c - 1;
+        }
+    }
+
+    // Every edit adds one to the line's mark; anything missing was overwritten
+    long lost = 0;
+    for (int q = 0; q < nq; ++q) {
+        int before = base[q];
+        int after = rubric_mark(rubric_after[q]);
+        long applied = before < 0 || after < 0 ? edits[q] : (after - before + 256) % 256;
+        if (edits[q] > applied) lost += edits[q] - applied;
+    }
+
+    long violations = skipped + reloaded + unmarked + extra_marks + stale + lost;
+
+    printf("Checker: %ld transitions logged (%ld dropped)\n", n, check_log->dropped);
+    printf("Checker: %d exams to mark, %d checked, %ld skipped, %ld loaded more than once\n",
+           sentinel, checked, skipped, reloaded);
+    printf("Checker: %ld questions never marked, %ld extra marks, %ld extra claims\n",
+           unmarked, extra_marks, extra_claims);
+    printf("Checker: %ld DONE writes landed on a newer exam\n", stale);
+    printf("Checker: %ld rubric edits, %ld lost, %ld reloads of an edited rubric file\n",
+           total_edits, lost, reloads);
+    printf("Checker: %ld violations\n", violations);
+    if (check_log->dropped) {
+        printf("Checker: log full after %d events, only exams 0-%d were checked\n",
+               CHECK_LOG_MAX, checked - 1);
+        printf("Checker: edits after that are in the final rubric but not the log, "
+               "so the lost edit count is unreliable\n");
+    }
+    fflush(stdout);
+
+    free(loaded);
+    free(replaced);
+    free(claims);
+    free(marks);
+    free(edits);
+    free(base);
+    return violations;
+}
+
+#endif
@@ -0,0 +1,62 @@
+// Per-TA random numbers for part2a/part2b (-s)
+// xoshiro256** seeded through splitmix64. Each TA seeds its own copy after
+// fork() from base_seed + id, so a given -s seed reproduces every TA's
+// rubric decisions and sleep durations exactly.
+// Dennis Chen student#101236818
+// Mithushan Ravichandramohan student#101262467
+
+#ifndef TA_RNG_H
+#define TA_RNG_H
+
+#include <stdint.h>
+#include <time.h>
+
+static uint64_t rng_state[4];
+static unsigned long long base_seed;
+
+static uint64_t splitmix64(uint64_t *x) {
+    uint64_t z = (*x += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+static void rng_seed(uint64_t seed) {
+    for (int i = 0; i < 4; ++i) {
+        rng_state[i] = splitmix64(&seed);
+    }
+}
+
+static uint64_t rotl(uint64_t x, int k) {
+    return (x << k) | (x >> (64 - k));
+}
+
+static uint64_t rng_next(void) {
+    uint64_t *s = rng_state;
+    uint64_t result = rotl(s[1] * 5, 7) * 9;
+    uint64_t t = s[1] << 17;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rotl(s[3], 45);
+    return result;
+}
+
+static double urand01(void) {
+    // uniform [0,1) from the top 53 bits
+    return (double)(rng_next() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static void sleep_random(double min_s, double max_s) {
+    double span = max_s - min_s;
+    double s = min_s + urand01() * span;
+    if (s < 0) s = 0;
+    struct timespec ts;
+    ts.tv_sec = (time_t)s;
+    ts.tv_nsec = (long)((s - ts.tv_sec) * 1e9);
+    nanosleep(&ts, NULL);
+}
+
+#endif
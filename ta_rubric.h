@@ -0,0 +1,94 @@
+// Rubric review policy for part2a/part2b (-r)
+// Decides when a TA reviews the rubric before starting an exam, and
+// notices edits made to the rubric file from outside the run.
+// Dennis Chen student#101236818
+// Mithushan Ravichandramohan student#101262467
+
+#ifndef TA_RUBRIC_H
+#define TA_RUBRIC_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ta_check.h"
+
+#define RUBRIC_LINE_MAX 32
+
+typedef enum {
+    RUBRIC_ALWAYS = 0,   // full five-line pass before every exam (original)
+    RUBRIC_EVERY_N,      // full pass on every Nth exam this TA starts
+    RUBRIC_ON_CHANGE,    // pass only if the rubric file was edited outside the run
+    RUBRIC_BATCH         // one delay and at most one save for the whole pass
+} rubric_policy_t;
+
+static rubric_policy_t rubric_policy = RUBRIC_ALWAYS;
+static int rubric_every_n = 1;
+
+// "always", "every:N" (N >= 1), "changed" or "batch". Returns -1 otherwise.
+static int parse_rubric_policy(const char *arg) {
+    if (strcmp(arg, "always") == 0) {
+        rubric_policy = RUBRIC_ALWAYS;
+    } else if (strncmp(arg, "every:", 6) == 0) {
+        rubric_policy = RUBRIC_EVERY_N;
+        rubric_every_n = atoi(arg + 6);
+        if (rubric_every_n < 1) return -1;
+    } else if (strcmp(arg, "changed") == 0) {
+        rubric_policy = RUBRIC_ON_CHANGE;
+    } else if (strcmp(arg, "batch") == 0) {
+        rubric_policy = RUBRIC_BATCH;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+static const char *rubric_policy_name(rubric_policy_t p) {
+    switch (p) {
+        case RUBRIC_ALWAYS:    return "always";
+        case RUBRIC_EVERY_N:   return "every";
+        case RUBRIC_ON_CHANGE: return "changed";
+        case RUBRIC_BATCH:     return "batch";
+        default:               return "unknown";
+    }
+}
+
+// Re-reads the rubric file and compares it with on_disk, the rubric as the
+// run last loaded or saved it. TA corrections are saved through on_disk and
+// so never count as a change. If someone else edited the file, its lines
+// are copied into text and on_disk and 1 is returned. A short file (e.g.
+// one caught mid-save) is ignored until the next call. In -c mode TA id
+// logs the reload of every line, since it overwrites unsaved edits too.
+static int rubric_file_changed(int id, const char *path, int nq,
+                               char (*text)[RUBRIC_LINE_MAX],
+                               char (*on_disk)[RUBRIC_LINE_MAX]) {
+    FILE *f = fopen(path, "r");
+    if (!f) return 0;
+
+    char disk[nq][RUBRIC_LINE_MAX];
+    char buf[128];
+    for (int i = 0; i < nq; ++i) {
+        if (!fgets(buf, sizeof(buf), f)) {
+            fclose(f);
+            return 0;
+        }
+        buf[strcspn(buf, "\r\n")] = '\0';
+        snprintf(disk[i], sizeof(disk[i]), "%.31s", buf);
+    }
+    fclose(f);
+
+    for (int i = 0; i < nq; ++i) {
+        if (strcmp(disk[i], on_disk[i]) != 0) {
+            for (int q = 0; q < nq; ++q) {
+                check_event(id, EV_RUBRIC_RELOAD, -1, q,
+                            rubric_mark(text[q]), rubric_mark(disk[q]));
+            }
+            memcpy(text, disk, sizeof(disk));
+            memcpy(on_disk, disk, sizeof(disk));
+            return 1;
+        }
+    }
+    return 0;
+}
+
+#endif
@@ -0,0 +1,158 @@
+// ta_stat: live view of a running part2a/part2b
+// Attaches read-only to the shared memory segment and prints per-TA and
+// global rates once a second until the run finishes.
+// Dennis Chen student#101236818
+// Mithushan Ravichandramohan student#101262467
+
+#define _XOPEN_SOURCE 700
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <signal.h>
+
+#include "ta_stats.h"
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void die(const char *msg) {
+    perror(msg);
+    exit(EXIT_FAILURE);
+}
+
+// Seconds blocked on semaphore s as of snapshot time at, including a wait
+// still in progress (blocked_ns only grows when a wait ends)
+static double blocked_s(const ta_stats_t *a, int s, double at) {
+    double blocked = a->blocked_ns[s] / 1e9;
+    if (a->wait_start_ns && a->wait_sem == s) blocked += at - a->wait_start_ns / 1e9;
+    return blocked;
+}
+
+static void print_blocked(const stats_t *cur, const ta_stats_t *a, const ta_stats_t *b,
+                          double t_cur, double t_prev) {
+    // Blocked time as a fraction of the interval, per semaphore
+    double dt = t_cur - t_prev;
+    for (int s = 0; s < cur->num_sems; ++s) {
+        double blocked = blocked_s(a, s, t_cur) - blocked_s(b, s, t_prev);
+        printf(" %s %3.0f%%", cur->sem_names[s], 100.0 * blocked / dt);
+    }
+    printf("\n");
+}
+
+static void print_tick(const stats_t *cur, const stats_t *prev,
+                       double t_cur, double t_prev, double t) {
+    double dt = t_cur - t_prev;
+    long marked = 0, d_marked = 0, completed = 0, edits = 0;
+    for (int i = 0; i < cur->num_tas; ++i) {
+        marked += cur->ta[i].questions_marked;
+        d_marked += cur->ta[i].questions_marked - prev->ta[i].questions_marked;
+        completed += cur->ta[i].exams_completed;
+        edits += cur->ta[i].rubric_edits;
+    }
+
+    // num_exams is 0 when exams are streamed and the total is unknown
+    char total[16] = "?";
+    if (cur->num_exams > 0) snprintf(total, sizeof(total), "%d", cur->num_exams);
+    printf("[%6.1fs] exam %d/%s  marked %ld (%.2f/s)  completed %ld  rubric edits %ld\n",
+           t, cur->current_exam_index + 1, total, marked,
+           d_marked / dt, completed, edits);
+
+    for (int i = 0; i < cur->num_tas; ++i) {
+        const ta_stats_t *a = &cur->ta[i];
+        const ta_stats_t *b = &prev->ta[i];
+        printf("  TA %-2d %-4s exam %-3d marked %-4ld (%.2f/s) completed %-3ld edits %-3ld",
+               i, a->active ? "run" : "done", a->current_exam_index,
+               a->questions_marked, (a->questions_marked - b->questions_marked) / dt,
+               a->exams_completed, a->rubric_edits);
+        print_blocked(cur, a, b, t_cur, t_prev);
+    }
+    // With -e in part2b the loader waits on ring_slots while the ring is full
+    if (cur->num_exams == 0 && cur->num_sems > 0) {
+        printf("  loader   %-4s", cur->loader.active ? "run" : "done");
+        print_blocked(cur, &cur->loader, &prev->loader, t_cur, t_prev);
+    }
+    fflush(stdout);
+}
+
+// SysV segments are given by shmid, POSIX ones (part2b -b posix) by name
+static const stats_t *attach(const char *arg) {
+    if (arg[0] == '/') {
+        int fd = shm_open(arg, O_RDONLY, 0);
+        if (fd < 0) die("shm_open");
+        void *p = mmap(NULL, sizeof(stats_t), PROT_READ, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED) die("mmap");
+        close(fd);
+        return (const stats_t *)p;
+    }
+    void *p = shmat(atoi(arg), NULL, SHM_RDONLY);
+    if (p == (void *)-1) die("shmat");
+    return (const stats_t *)p;
+}
+
+static void detach(const char *arg, const stats_t *live) {
+    if (arg[0] == '/') {
+        munmap((void *)live, sizeof(stats_t));
+    } else {
+        shmdt(live);
+    }
+}
+
+// A killed run never sets done. Treat it as over once the parent no longer
+// exists or, for SysV, once nobody but us is attached to the segment.
+static int run_gone(const char *arg, const stats_t *s) {
+    if (s->owner_pid > 0 && kill(s->owner_pid, 0) < 0 && errno == ESRCH) return 1;
+    if (arg[0] != '/') {
+        struct shmid_ds ds;
+        if (shmctl(atoi(arg), IPC_STAT, &ds) < 0 || ds.shm_nattch <= 1) return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s <shmid|/shm-name>\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    const stats_t *live = attach(argv[1]);
+
+    if (live->magic != STATS_MAGIC) {
+        fprintf(stderr, "Segment %s is not a part2a/part2b run\n", argv[1]);
+        detach(argv[1], live);
+        return EXIT_FAILURE;
+    }
+
+    // Work from snapshots so one tick is internally consistent enough
+    stats_t prev, cur;
+    memcpy(&prev, live, sizeof(prev));
+    double start = now_s(), last = start;
+
+    while (!prev.done) {
+        sleep(1);
+        memcpy(&cur, live, sizeof(cur));
+        double t = now_s();
+        print_tick(&cur, &prev, t, last, t - start);
+        prev = cur;
+        last = t;
+        if (!cur.done && run_gone(argv[1], &cur)) {
+            printf("Run ended without finishing (parent %d gone).\n", cur.owner_pid);
+            detach(argv[1], live);
+            return EXIT_FAILURE;
+        }
+    }
+
+    printf("Run finished.\n");
+    detach(argv[1], live);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,41 @@
+// Live run counters shared between part2a/part2b and ta_stat
+// Dennis Chen student#101236818
+// Mithushan Ravichandramohan student#101262467
+
+#ifndef TA_STATS_H
+#define TA_STATS_H
+
+#define STATS_MAGIC     0x54415354u  // "TAST"
+#define STATS_MAX_TAS   64
+#define STATS_MAX_SEMS  8
+
+// Each TA only ever writes its own slot, so no locking is needed and the
+// TAs pay nothing beyond a plain increment. ta_stat sums the slots.
+typedef struct {
+    long questions_marked;
+    long exams_completed;              // exams this TA closed by loading the next one
+    long rubric_edits;
+    long blocked_ns[STATS_MAX_SEMS];   // time spent waiting in P(), per semaphore
+                                       // (added when the wait ends)
+    long wait_start_ns;                // CLOCK_MONOTONIC start of the current wait, 0 if none
+    int  wait_sem;                     // semaphore of the current wait
+    int  current_exam_index;           // exam this TA last claimed a question from
+    int  active;                       // 1 while the TA process is running
+} ta_stats_t;
+
+// Must be the first member of shared_t: ta_stat attaches to the segment
+// read-only and only knows about this part of the layout.
+typedef struct {
+    unsigned   magic;
+    int        num_tas;
+    int        num_exams;
+    int        num_sems;                    // 0 for part2a
+    char       sem_names[STATS_MAX_SEMS][16];
+    int        current_exam_index;
+    int        done;                        // set by the parent once all TAs exit
+    int        owner_pid;                   // parent; if it dies done is never set
+    ta_stats_t ta[STATS_MAX_TAS];
+    ta_stats_t loader;                      // -e exam loader, only blocked_ns/active
+} stats_t;
+
+#endif
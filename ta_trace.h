@@ -0,0 +1,137 @@
+// Claim trace for part2a/part2b (-t record:FILE|replay:FILE)
+// Every change to which questions are claimable is an event in the trace:
+// a pick attempt ('C', question or -1 if none left), a DONE write ('D') or
+// an exam load ('L'). DONE writes matter because one that lands after the
+// next exam was loaded marks a question of that exam. Pick results depend
+// only on the order of these events, so replaying the order reproduces who
+// marks what. One line per event:
+// "<seq> <ta> <C|D|L> <exam_index> <question>".
+// Dennis Chen student#101236818
+// Mithushan Ravichandramohan student#101262467
+
+#ifndef TA_TRACE_H
+#define TA_TRACE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "ta_stats.h"
+
+// Lives in shared memory next to the state the events describe
+typedef struct {
+    int seq;                   // events so far, i.e. the next event's sequence number
+    int gone[STATS_MAX_TAS];   // replay: TA has exited, nobody should wait for it
+} trace_shared_t;
+
+typedef struct {
+    int  ta;
+    char kind;
+    int  exam;
+    int  q;
+} claim_t;
+
+static int trace_fd = -1;        // record mode: shared O_APPEND descriptor
+static claim_t *replay = NULL;   // replay mode: events indexed by seq
+static int replay_len = 0;
+
+static void trace_record(int seq, int id, char kind, int exam, int q) {
+    char line[64];
+    int len = snprintf(line, sizeof(line), "%d %d %c %d %d\n", seq, id, kind, exam, q);
+    // One write() per line on an O_APPEND fd keeps lines from different TAs whole
+    if (write(trace_fd, line, (size_t)len) != len) {
+        perror("write trace");
+    }
+}
+
+static void load_replay_trace(const char *path, int num_tas) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        perror("fopen trace");
+        exit(EXIT_FAILURE);
+    }
+
+    int seq, ta, exam, q;
+    char kind;
+    while (fscanf(f, "%d %d %c %d %d", &seq, &ta, &kind, &exam, &q) == 5) {
+        replay_len++;
+    }
+    // Never NULL, even for an empty trace: replay != NULL means replay mode
+    replay = calloc(replay_len ? (size_t)replay_len : 1, sizeof(*replay));
+    if (!replay) {
+        perror("calloc trace");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < replay_len; ++i) {
+        replay[i].ta = -1;
+    }
+
+    // Lines may be out of order (TAs append concurrently), so place by seq
+    rewind(f);
+    while (fscanf(f, "%d %d %c %d %d", &seq, &ta, &kind, &exam, &q) == 5) {
+        if (seq < 0 || seq >= replay_len || replay[seq].ta != -1 ||
+            ta < 0 || ta >= num_tas || (kind != 'C' && kind != 'D' && kind != 'L')) {
+            fprintf(stderr, "Trace %s: bad or duplicate event %d (TA %d)\n",
+                    path, seq, ta);
+            exit(EXIT_FAILURE);
+        }
+        replay[seq].ta = ta;
+        replay[seq].kind = kind;
+        replay[seq].exam = exam;
+        replay[seq].q = q;
+    }
+    fclose(f);
+}
+
+// Number of trace events at or after seq that belong to TA id
+static int replay_events_left(int id, int seq) {
+    int n = 0;
+    for (int i = seq; i < replay_len; ++i) {
+        if (replay[i].ta == id) n++;
+    }
+    return n;
+}
+
+// Replay mode: wait until the trace says the next event is ours. Once the
+// trace runs out TAs proceed freely. terminate alone is no reason to stop:
+// the other TAs' last DONE writes follow it in the trace, so we keep
+// waiting while any of our own events are left. Returns 0 once none are,
+// or if the TA whose turn it is has already exited.
+static int wait_for_turn(int id, trace_shared_t *tr, const int *terminate) {
+    if (!replay) return 1;
+    struct timespec ts = { 0, 1000000 };  // 1 ms poll
+    while (1) {
+        int seq = __atomic_load_n(&tr->seq, __ATOMIC_ACQUIRE);
+        if (seq >= replay_len || replay[seq].ta == id) return 1;
+        if (__atomic_load_n(&tr->gone[replay[seq].ta], __ATOMIC_ACQUIRE)) return 0;
+        if (*terminate && replay_events_left(id, seq) == 0) return 0;
+        nanosleep(&ts, NULL);
+    }
+}
+
+// Record or check an event we just performed on exam. Returns 1 if replay
+// diverged.
+static int note_event(int id, trace_shared_t *tr, char kind, int exam, int q) {
+    int seq = __atomic_fetch_add(&tr->seq, 1, __ATOMIC_ACQ_REL);
+    if (trace_fd >= 0) {
+        trace_record(seq, id, kind, exam, q);
+    }
+    if (replay && seq < replay_len &&
+        (replay[seq].ta != id || replay[seq].kind != kind ||
+         replay[seq].exam != exam || replay[seq].q != q)) {
+        return 1;
+    }
+    return 0;
+}
+
+// Called by a TA on its way out. Marks it gone so nobody waits for its
+// turn and returns how many of its trace events will now never run; they
+// count as divergences.
+static int replay_finish(int id, trace_shared_t *tr) {
+    if (!replay) return 0;
+    __atomic_store_n(&tr->gone[id], 1, __ATOMIC_RELEASE);
+    return replay_events_left(id, __atomic_load_n(&tr->seq, __ATOMIC_ACQUIRE));
+}
+
+#endif